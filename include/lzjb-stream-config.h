@@ -18,6 +18,15 @@
 /*#undef LZJBSTREAM_WITH_STDBOOL*/
 
 
+/** Undefine this to leave out the compressor, i.e. @c lzjbstream_compress().
+ *
+ * Decompression-only targets (small embedded systems) can save some code
+ * space this way, since the compressor is typically run on a host.
+*/
+#define LZJBSTREAM_WITH_COMPRESS
+/*#undef LZJBSTREAM_WITH_COMPRESS*/
+
+
 #if !defined LZJBSTREAM_WITH_STDBOOL
 /* This is an example only. Feel free to delete and provide your own. */
 typedef int bool;
@@ -52,8 +52,9 @@
  * The two modes differ in how the streaming library writes its output (the decompressed data) and also how it re-reads such data.
  * Re-reading of already decompressed data is a crucial operation since the compression is achieved by back-referencing repeating data.
  *
- * @note The library does not assume any header information in the compressed data; in particular you are responsible for providing
- *       the size of the final decompressed data when initializing the stream. The size encoding functions can be helpful, here.
+ * @note The memory- and file-oriented modes do not assume any header information in the compressed data; in particular you are responsible
+ *       for providing the size of the final decompressed data when initializing the stream. The size encoding functions can be helpful, here.
+ *       If the data is prefixed with its encoded size, the allocator-oriented mode can parse it for you.
  *
  * <dl>
  * <dt>Memory-oriented streaming</dt>
@@ -67,12 +68,27 @@
  * In file-oriented streaming, writing output and reading already-written output is deferred to user-supplied functions.
  * To set up a file-oriented stream, use @ref lzjbstream_init_file().
  * </dd>
+ *
+ * <dt>Allocator-oriented streaming</dt>
+ * <dd>
+ * In allocator-oriented streaming, the compressed data starts with the decompressed size, as encoded by @ref lzjbstream_size_encode().
+ * The stream parses the size itself, even if it arrives split across several calls, and then asks a user-supplied function for a
+ * destination buffer of exactly that size. From then on it works like a memory-oriented stream.
+ * To set up an allocator-oriented stream, use @ref lzjbstream_init_alloc().
+ * </dd>
  * </dl>
  *
  * Once a stream has been initialized, all the application has to do is feed it compressed data to uncompress.
  * This is done using the @ref lzjbstream_decompress() function, which returns @c false when decompression is done.
  * You can also query a stream for completeness using the @ref lzjbstream_is_finished() function.
  *
+ * ## Compression ##
+ * For producing compressed data, the library provides a simple one-shot compressor, @ref lzjbstream_compress().
+ * Unlike the decompressor it is not streaming: all of the input must be available in memory.
+ * It supports a couple of compression levels, trading compression speed for output size; see @ref LZJBStreamLevel.
+ * All levels generate plain LZJB, so the output can be decompressed by @ref lzjbstream_decompress() as usual.
+ * The compressor can be left out of the build, see @ref lzjb-stream-config.h.
+ *
 */
 
 #if !defined LZJBSTREAM_H_
@@ -97,6 +113,9 @@ typedef uint8_t	(*LZJBStreamGetC)(size_t offset, void *user);
 /** @brief Function pointer for a writing function, used to store newly-generated decompressed bytes. */
 typedef void	(*LZJBStreamPutC)(size_t offset, uint8_t byte, void *user);
 
+/** @brief Function pointer for an allocation function, used to get the destination buffer once the decompressed size is known. */
+typedef void *	(*LZJBStreamAlloc)(size_t size, void *user);
+
 /** @brief The LZJB stream decompressor's state.
  *
  * This structure has no public fields: it is declared in public only to
@@ -108,15 +127,27 @@ typedef struct {	/**  @cond INTERNAL */
 	size_t		dst_size;
 	LZJBStreamGetC	f_getc;
 	LZJBStreamPutC	f_putc;
+	LZJBStreamAlloc	f_alloc;
 	void		*user;
 
 	uint8_t		copymask;
 	uint8_t		copymap;
 	uint8_t		copyshift;
 	uint8_t		copy0;
+	uint8_t		size_shift;
 	bool		copynow;	/** @endcond INTERNAL */
 } LZJBStream;
 
+/** @brief Compression levels, for use with @ref lzjbstream_compress().
+ *
+ * The levels only affect how hard the compressor searches for matches, the
+ * output format is the same for all of them.
+*/
+typedef enum {
+	LZJBSTREAM_LEVEL_FAST = 1,	/**< Classic LZJB: a single hash table probe per position. Fast, but misses many matches. */
+	LZJBSTREAM_LEVEL_HIGH = 2	/**< Searches the entire window using hash chains, and does lazy matching. Slow, but compresses better. */
+} LZJBStreamLevel;
+
 /* ----------------------------------------------------------------- */
 
 /** @brief Encodes a size using a variable-length format.
@@ -180,6 +211,26 @@ bool lzjbstream_init_memory(LZJBStream *stream, void *dst, size_t dst_size);
 bool lzjbstream_init_file(LZJBStream *stream, size_t dst_size, LZJBStreamGetC file_getc, LZJBStreamPutC file_putc, void *user);
 
 
+/** @brief Initializes a stream for "allocator" streaming, in which the compressed data is prefixed by its
+ * decompressed size, and the destination buffer is requested from a user-supplied callback.
+ *
+ * The size prefix is in the format written by @ref lzjbstream_size_encode(), and is parsed by
+ * @c lzjbstream_decompress() as it arrives; it may be split across any number of calls. Once it
+ * is complete, @c alloc() is called exactly once to get the destination buffer, which is then
+ * used just like with @ref lzjbstream_init_memory(). If the size is zero, no allocation is done and
+ * the stream is immediately finished.
+ *
+ * @param stream	The stream to initialize.
+ * @param alloc		A pointer to a function that returns a destination buffer of (at least) the given
+ *			number of bytes, or @c NULL on failure. This can hand out memory from an arena,
+ *			a pre-registered DMA buffer, and so on; it doesn't have to be a heap allocation.
+ * @param user		User-provided data pointer, which is passed to @c alloc().
+ *
+ * @return @c true on success, @c false on error (one or more parameter had an invalid value).
+*/
+bool lzjbstream_init_alloc(LZJBStream *stream, LZJBStreamAlloc alloc, void *user);
+
+
 /** @brief Answers whether a given stream has finished decompressing.
  *
  * @param stream	The stream to query.
@@ -198,7 +249,34 @@ bool lzjbstream_is_finished(const LZJBStream *stream);
  *			be fully consumed by this call.
  *
  * @return @c true if another call is needed, @c false if the requested number of output bytes has been generated.
+ * For allocator-oriented streams, @c false is also returned if the size prefix is malformed or the allocation
+ * failed; use @ref lzjbstream_is_finished() to tell the two apart.
 */
 bool lzjbstream_decompress(LZJBStream *stream, const void *src, size_t src_size);
 
+/* ----------------------------------------------------------------- */
+
+#if defined LZJBSTREAM_WITH_COMPRESS
+
+/** @brief Compresses a buffer of data.
+ *
+ * This is not streaming, the entire input must be available. The output contains no size
+ * information; use @ref lzjbstream_size_encode() if the decompressing side needs it.
+ *
+ * The compressor does no heap allocations, but uses a few KB of stack for its match-finding tables.
+ * In the worst case (incompressible input) the output is @c src_size + (@c src_size + 7) / 8 bytes.
+ *
+ * @param dst		Buffer into which the compressed data will be written.
+ * @param dst_max	Maximum number of bytes available at dst.
+ * @param src		Data to compress.
+ * @param src_size	Number of bytes to compress.
+ * @param level		Compression level to use.
+ *
+ * @return The number of compressed bytes written to @c dst, or 0 on error (invalid parameter,
+ * or the output didn't fit in @c dst_max bytes).
+*/
+size_t lzjbstream_compress(void *dst, size_t dst_max, const void *src, size_t src_size, LZJBStreamLevel level);
+
+#endif		/* LZJBSTREAM_WITH_COMPRESS */
+
 #endif		/* LZJBSTREAM_H_ */
@@ -116,21 +116,89 @@ bool lzjbstream_init_file(LZJBStream *stream, size_t dst_size, LZJBStreamGetC fi
 	stream->dst_size = dst_size;
 	stream->f_getc = file_getc;
 	stream->f_putc = file_putc;
+	stream->f_alloc = NULL;
 	stream->user = user;
 
 	stream->copymask = 0;
 	stream->copyshift = 0;
 	stream->copynow = false;
+	stream->size_shift = 0;
 
 	return true;
 }
 
 /* ----------------------------------------------------------------- */
 
+/* Marks an allocator-oriented stream as failed; f_alloc stays set so it never looks finished. */
+#define	SIZE_SHIFT_FAILED	0xff
+
+bool lzjbstream_init_alloc(LZJBStream *stream, LZJBStreamAlloc alloc, void *user)
+{
+	if(stream == NULL || alloc == NULL)
+		return false;
+
+	stream->dst_pos = 0;
+	stream->dst_size = 0;
+	stream->f_getc = memory_getc;
+	stream->f_putc = memory_putc;
+	stream->f_alloc = alloc;
+	stream->user = user;
+
+	stream->copymask = 0;
+	stream->copyshift = 0;
+	stream->copynow = false;
+	stream->size_shift = 0;
+
+	return true;
+}
+
+/* Incrementally parse the size prefix, accumulating it in dst_size. Once it is complete, allocates the
+ * destination and clears f_alloc, turning the stream into a memory stream. Returns NULL on failure.
+*/
+static const uint8_t * size_prefix_feed(LZJBStream *stream, const uint8_t *get, const uint8_t *get_end)
+{
+	const unsigned int	size_bits = sizeof stream->dst_size * BITS_PER_BYTE;
+
+	while(get < get_end)
+	{
+		const uint8_t	here = *get++;
+		const size_t	payload = here & SIZE_MASK;
+
+		/* Reject prefixes whose value doesn't fit in a size_t, rather than truncating them. */
+		if(stream->size_shift >= size_bits ||
+		   ((unsigned int) stream->size_shift + SIZE_BITS > size_bits && (payload >> (size_bits - stream->size_shift)) != 0))
+		{
+			stream->size_shift = SIZE_SHIFT_FAILED;
+			return NULL;
+		}
+		stream->dst_size |= payload << stream->size_shift;
+		if(here & SIZE_LAST)
+		{
+			if(stream->dst_size > 0)
+			{
+				void * const dst = stream->f_alloc(stream->dst_size, stream->user);
+				if(dst == NULL)
+				{
+					stream->size_shift = SIZE_SHIFT_FAILED;
+					return NULL;
+				}
+				stream->user = dst;
+			}
+			stream->f_alloc = NULL;
+			stream->size_shift = 0;
+			return get;
+		}
+		stream->size_shift += SIZE_BITS;
+	}
+	return get;	/* Out of input, the prefix continues in the next call. */
+}
+
+/* ----------------------------------------------------------------- */
+
 bool lzjbstream_is_finished(const LZJBStream *stream)
 {
 	if(stream != NULL)
-		return stream->dst_pos >= stream->dst_size;
+		return stream->f_alloc == NULL && stream->dst_pos >= stream->dst_size;
 	return false;
 }
 
@@ -161,6 +229,15 @@ bool lzjbstream_decompress(LZJBStream *stream, const void *src, size_t src_size)
 
 	if(stream == NULL || src == NULL || src_size == 0)
 		return false;
+	if(stream->f_alloc != NULL)
+	{
+		if(stream->size_shift == SIZE_SHIFT_FAILED || (get = size_prefix_feed(stream, get, get_end)) == NULL)
+			return false;
+		if(stream->f_alloc != NULL)
+			return true;	/* Size prefix not complete yet. */
+		if(get >= get_end)
+			return stream->dst_pos < stream->dst_size;
+	}
 	if(stream->dst_pos >= stream->dst_size)
 		return false;
 
@@ -211,3 +288,270 @@ bool lzjbstream_decompress(LZJBStream *stream, const void *src, size_t src_size)
 	}
 	return (stream->dst_pos < stream->dst_size) ? true : false;
 }
+
+/* ----------------------------------------------------------------- */
+
+#if defined LZJBSTREAM_WITH_COMPRESS
+
+#define	MATCH_MAX	((1 << MATCH_BITS) + (MATCH_MIN - 1))
+
+#define	HASH_BITS	10
+#define	HASH_SIZE	(1 << HASH_BITS)
+
+/* Positions are stored truncated to 16 bits, to keep the tables small. Since the window is
+ * only OFFSET_MASK bytes, the distance back to a stored position is recovered modulo 2^16.
+ * Stale entries can alias, but every candidate is verified byte-by-byte so that is harmless.
+*/
+#define	POS_MASK	0xffff
+
+typedef struct {
+	uint16_t	head[HASH_SIZE];		/* Most recent position for each hash value. */
+	uint16_t	prev[OFFSET_MASK + 1];		/* Previous position with the same hash, indexed by position in window. */
+} MatchFinder;
+
+typedef struct {
+	uint8_t		*put;
+	uint8_t		*put_end;
+	uint8_t		*copymap;
+	uint8_t		copymask;
+} Emitter;
+
+static unsigned int hash3(const uint8_t *src)
+{
+	unsigned int	hash = ((unsigned int) src[0] << 16) + ((unsigned int) src[1] << 8) + src[2];
+
+	hash += hash >> 9;
+	hash += hash >> 5;
+	return hash & (HASH_SIZE - 1);
+}
+
+static size_t distance(size_t pos, uint16_t stored)
+{
+	return (pos - stored) & POS_MASK;
+}
+
+static bool is_valid_distance(size_t pos, size_t dist)
+{
+	return dist > 0 && dist <= OFFSET_MASK && dist <= pos;
+}
+
+static unsigned int match_length(const uint8_t *a, const uint8_t *b, unsigned int max)
+{
+	unsigned int	len = 0;
+
+	while(len < max && a[len] == b[len])
+		++len;
+	return len;
+}
+
+/* Add the three bytes at pos to the hash chains. */
+static void finder_insert(MatchFinder *mf, const uint8_t *src, size_t pos)
+{
+	const unsigned int	hash = hash3(src + pos);
+
+	mf->prev[pos & OFFSET_MASK] = mf->head[hash];
+	mf->head[hash] = (uint16_t) (pos & POS_MASK);
+}
+
+/* Walk the hash chain for the bytes at pos, looking for the longest match in the entire window.
+ * Must be called before pos itself is inserted.
+*/
+static unsigned int finder_longest(const MatchFinder *mf, const uint8_t *src, size_t pos, unsigned int max, size_t *offset)
+{
+	size_t		dist = distance(pos, mf->head[hash3(src + pos)]);
+	unsigned int	best = 0;
+
+	while(is_valid_distance(pos, dist))
+	{
+		const unsigned int	len = match_length(src + pos, src + pos - dist, max);
+		size_t			next;
+
+		if(len > best)
+		{
+			best = len;
+			*offset = dist;
+			if(best == max)
+				break;
+		}
+		/* Chain entries only get older; anything that doesn't is an alias, so stop. */
+		next = distance(pos, mf->prev[(pos - dist) & OFFSET_MASK]);
+		if(next <= dist)
+			break;
+		dist = next;
+	}
+	return best;
+}
+
+/* Reserve room for the next item, starting a new copymap byte when needed. */
+static bool emit_begin(Emitter *emitter, size_t item_size)
+{
+	emitter->copymask = (uint8_t) ((unsigned int) emitter->copymask << 1);
+	if(emitter->copymask == 0)
+	{
+		if(emitter->put_end - emitter->put < 1)
+			return false;
+		emitter->copymap = emitter->put++;
+		*emitter->copymap = 0;
+		emitter->copymask = 1;
+	}
+	return (size_t) (emitter->put_end - emitter->put) >= item_size;
+}
+
+static bool emit_literal(Emitter *emitter, uint8_t byte)
+{
+	if(!emit_begin(emitter, 1))
+		return false;
+	*emitter->put++ = byte;
+	return true;
+}
+
+static bool emit_copy(Emitter *emitter, unsigned int mlen, size_t offset)
+{
+	if(!emit_begin(emitter, 2))
+		return false;
+	*emitter->copymap |= emitter->copymask;
+	*emitter->put++ = (uint8_t) (((mlen - MATCH_MIN) << (BITS_PER_BYTE - MATCH_BITS)) | (offset >> BITS_PER_BYTE));
+	*emitter->put++ = (uint8_t) offset;
+	return true;
+}
+
+static unsigned int max_match(size_t pos, size_t src_size)
+{
+	return src_size - pos < MATCH_MAX ? (unsigned int) (src_size - pos) : MATCH_MAX;
+}
+
+/* The classic LZJB compressor: one hash table probe per position, no chains. */
+static bool compress_fast(Emitter *emitter, MatchFinder *mf, const uint8_t *src, size_t src_size)
+{
+	size_t	pos = 0;
+
+	while(pos < src_size)
+	{
+		const unsigned int	max = max_match(pos, src_size);
+		unsigned int		mlen = 0;
+		size_t			offset = 0;
+
+		if(max >= MATCH_MIN)
+		{
+			const unsigned int hash = hash3(src + pos);
+
+			offset = distance(pos, mf->head[hash]);
+			mf->head[hash] = (uint16_t) (pos & POS_MASK);
+			if(is_valid_distance(pos, offset))
+				mlen = match_length(src + pos, src + pos - offset, max);
+		}
+		if(mlen >= MATCH_MIN)
+		{
+			if(!emit_copy(emitter, mlen, offset))
+				return false;
+			pos += mlen;
+		}
+		else
+		{
+			if(!emit_literal(emitter, src[pos]))
+				return false;
+			++pos;
+		}
+	}
+	return true;
+}
+
+/* Full-window hash chain search with lazy matching: a match is only emitted if the
+ * match starting at the next position is not longer, otherwise a literal is emitted
+ * and the decision is deferred by one byte.
+*/
+static bool compress_high(Emitter *emitter, MatchFinder *mf, const uint8_t *src, size_t src_size)
+{
+	size_t		pos = 0, prev_offset = 0;
+	unsigned int	prev_len = 0;
+
+	while(pos < src_size)
+	{
+		const unsigned int	max = max_match(pos, src_size);
+		unsigned int		mlen = 0;
+		size_t			offset = 0;
+
+		if(max >= MATCH_MIN)
+		{
+			mlen = finder_longest(mf, src, pos, max, &offset);
+			finder_insert(mf, src, pos);
+		}
+		if(prev_len >= MATCH_MIN)
+		{
+			if(mlen > prev_len)
+			{
+				/* Better match here; the previous position becomes a literal. */
+				if(!emit_literal(emitter, src[pos - 1]))
+					return false;
+				prev_len = mlen;
+				prev_offset = offset;
+				++pos;
+				continue;
+			}
+			/* The previous match wins. It started at pos - 1, and pos is already inserted. */
+			if(!emit_copy(emitter, prev_len, prev_offset))
+				return false;
+			mlen = prev_len - 1;
+			prev_len = 0;
+		}
+		else if(mlen >= MATCH_MIN && mlen < max)
+		{
+			/* Defer, to see if the next position has a longer match. */
+			prev_len = mlen;
+			prev_offset = offset;
+			++pos;
+			continue;
+		}
+		else if(mlen >= MATCH_MIN)
+		{
+			if(!emit_copy(emitter, mlen, offset))
+				return false;
+		}
+		else
+		{
+			if(!emit_literal(emitter, src[pos]))
+				return false;
+			mlen = 1;
+		}
+		/* Skip over the bytes covered, inserting them so later matches can find them. */
+		for(++pos, --mlen; mlen > 0; --mlen, ++pos)
+		{
+			if(src_size - pos >= MATCH_MIN)
+				finder_insert(mf, src, pos);
+		}
+	}
+	if(prev_len >= MATCH_MIN)
+		return emit_copy(emitter, prev_len, prev_offset);
+	return true;
+}
+
+size_t lzjbstream_compress(void *dst, size_t dst_max, const void *src, size_t src_size, LZJBStreamLevel level)
+{
+	MatchFinder	mf;
+	Emitter		emitter;
+	bool		ok;
+
+	if(dst == NULL || src == NULL || src_size == 0)
+		return 0;
+
+	memset(&mf, 0, sizeof mf);
+	emitter.put = dst;
+	emitter.put_end = emitter.put + dst_max;
+	emitter.copymap = NULL;
+	emitter.copymask = 1 << (BITS_PER_BYTE - 1);	/* Forces a copymap byte before the first item. */
+
+	switch(level)
+	{
+	case LZJBSTREAM_LEVEL_FAST:
+		ok = compress_fast(&emitter, &mf, src, src_size);
+		break;
+	case LZJBSTREAM_LEVEL_HIGH:
+		ok = compress_high(&emitter, &mf, src, src_size);
+		break;
+	default:
+		return 0;
+	}
+	return ok ? (size_t) (emitter.put - (uint8_t *) dst) : 0;
+}
+
+#endif		/* LZJBSTREAM_WITH_COMPRESS */
@@ -208,6 +208,262 @@ static void test_decompress(void)
 		test_failed("Failed random-chunked streaming decompression, resulting len=%zu (expected %zu)", len3, sizeof test_original);
 }
 
+/* ----------------------------------------------------------------- */
+
+#if defined LZJBSTREAM_WITH_COMPRESS
+
+/* Generates a reproducible corpus: pseudo-random text made from a small vocabulary, interleaved
+ * with a few recurring tables of binary data. Uses its own generator so the output doesn't depend on libc.
+*/
+static void * make_corpus(size_t length)
+{
+	static const char * const words[] = { "the", "stream", "firmware", "update", "of", "and", "lzjb", "block",
+		"compress", "offset", "match", "to", "a", "in", "is", "buffer", "size_t", "return", "value", "device" };
+	uint8_t		*buf = malloc(length);
+	uint32_t	seed = 0x1badcafe;
+	size_t		pos = 0;
+
+	if(buf == NULL)
+		return NULL;
+	while(pos < length)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		if((seed >> 24) < 8)
+		{
+			/* One of a few tables of 16-bit counters, like a firmware image might have. */
+			uint16_t	counter = (uint16_t) (0x1000 * ((seed >> 16) & 3));
+			size_t		i;
+			for(i = 0; i < 64 && pos < length; ++i, counter += 3)
+				buf[pos++] = (uint8_t) (i & 1 ? counter >> 8 : counter);
+		}
+		else
+		{
+			const char	*word = words[(seed >> 16) % (sizeof words / sizeof *words)];
+			while(*word != '\0' && pos < length)
+				buf[pos++] = (uint8_t) *word++;
+			if(pos < length)
+				buf[pos++] = (seed & 0x700) == 0 ? '\n' : ' ';
+		}
+	}
+	return buf;
+}
+
+static const char * level_name(LZJBStreamLevel level)
+{
+	return level == LZJBSTREAM_LEVEL_FAST ? "fast" : "high";
+}
+
+static void test_compress_roundtrip(const void *data, size_t length, LZJBStreamLevel level)
+{
+	const size_t	cmax = length + (length + 7) / 8;
+	uint8_t		*cdat = malloc(cmax), *out = malloc(length);
+	LZJBStream	stream;
+	size_t		clen, pos;
+
+	if(cdat == NULL || out == NULL)
+	{
+		test_failed("Out of memory testing %zu-byte %s compression", length, level_name(level));
+		free(cdat);
+		free(out);
+		return;
+	}
+	clen = lzjbstream_compress(cdat, cmax, data, length, level);
+	if(clen == 0)
+		test_failed("Failed %s compression of %zu bytes, output didn't fit in %zu", level_name(level), length, cmax);
+	else
+	{
+		/* Decompress in random chunks, to make sure the output is plain streamable LZJB. */
+		memset(out, 0, length);
+		lzjbstream_init_memory(&stream, out, length);
+		for(pos = 0; pos < clen;)
+		{
+			size_t chunk = rand() % 19 + 1;
+			if(pos + chunk > clen)
+				chunk = clen - pos;
+			lzjbstream_decompress(&stream, cdat + pos, chunk);
+			pos += chunk;
+		}
+		if(lzjbstream_is_finished(&stream) && memcmp(out, data, length) == 0)
+			test_passed();
+		else
+			test_failed("Failed %s compression round-trip of %zu bytes", level_name(level), length);
+	}
+	free(out);
+	free(cdat);
+}
+
+static void test_compress(void)
+{
+	const char	text[] = "['LEMPEL_SIZE', 'MATCH_BITS', 'MATCH_MAX', 'MATCH_MIN', 'MATCH_RANGE', 'NBBY', 'OFFSET_MASK']";
+	const uint8_t	run[200] = { 0 };
+	const size_t	corpus_len = 100000;
+	void		*corpus = make_corpus(corpus_len);
+	uint8_t		tiny[2];
+	int		level;
+
+	for(level = LZJBSTREAM_LEVEL_FAST; level <= LZJBSTREAM_LEVEL_HIGH; ++level)
+	{
+		test_compress_roundtrip(text, strlen(text), level);
+		test_compress_roundtrip(run, sizeof run, level);
+		test_compress_roundtrip("x", 1, level);
+		if(corpus != NULL)
+			test_compress_roundtrip(corpus, corpus_len, level);
+	}
+	free(corpus);
+
+	/* Output that doesn't fit must fail cleanly. */
+	if(lzjbstream_compress(tiny, sizeof tiny, text, strlen(text), LZJBSTREAM_LEVEL_HIGH) == 0)
+		test_passed();
+	else
+		test_failed("Compression into a too-small buffer didn't fail");
+}
+
+static void test_compress_performance(void)
+{
+	const size_t	length = 4 << 20;
+	const size_t	cmax = length + (length + 7) / 8;
+	void		*corpus = make_corpus(length);
+	void		*cdat = malloc(cmax), *out = malloc(length);
+	int		level;
+
+	if(corpus == NULL || cdat == NULL || out == NULL)
+	{
+		printf("Couldn't allocate compression benchmark buffers, skipping\n");
+		free(out);
+		free(cdat);
+		free(corpus);
+		return;
+	}
+	for(level = LZJBSTREAM_LEVEL_FAST; level <= LZJBSTREAM_LEVEL_HIGH; ++level)
+	{
+		struct timeval	t0, t1;
+		LZJBStream	stream;
+		size_t		clen;
+		double		elapsed;
+
+		gettimeofday(&t0, NULL);
+		clen = lzjbstream_compress(cdat, cmax, corpus, length, level);
+		gettimeofday(&t1, NULL);
+		elapsed = t1.tv_sec - t0.tv_sec + 1e-6 * (t1.tv_usec - t0.tv_usec);
+		printf(" Level %d (%s): %zu => %zu bytes, ratio %.3f, %.1f MB/s\n", level, level_name(level), length, clen,
+			clen > 0 ? (double) length / clen : 0., length / (elapsed * 1024. * 1024.));
+
+		memset(out, 0, length);
+		lzjbstream_init_memory(&stream, out, length);
+		if(clen == 0 || lzjbstream_decompress(&stream, cdat, clen) || memcmp(out, corpus, length) != 0)
+			test_failed("Failed %s compression benchmark round-trip of %zu bytes", level_name(level), length);
+	}
+	free(out);
+	free(cdat);
+	free(corpus);
+}
+
+#endif		/* LZJBSTREAM_WITH_COMPRESS */
+
+/* ----------------------------------------------------------------- */
+
+/* A trivial arena allocator, handing out a fixed buffer once. */
+typedef struct {
+	uint8_t	buf[256];
+	size_t	requested;
+	int	calls;
+} Arena;
+
+static void * arena_alloc(size_t size, void *user)
+{
+	Arena * const arena = user;
+
+	++arena->calls;
+	arena->requested = size;
+	return size <= sizeof arena->buf ? arena->buf : NULL;
+}
+
+static void test_decompress_alloc(void)
+{
+	const char	text[] = "['LEMPEL_SIZE', 'MATCH_BITS', 'MATCH_MAX', 'MATCH_MIN', 'MATCH_RANGE', 'NBBY', 'OFFSET_MASK', "
+				"'__builtins__', '__doc__', '__file__', '__name__', '__package__', 'compress', 'decode_size']";
+	/* Size-prefixed (two bytes, so the 1-byte test below splits it) and compressed. */
+	const uint8_t	prefixed[] = { 0x3a, 0x81, 0x0, 0x5b, 0x27, 0x4c, 0x45, 0x4d, 0x50, 0x45, 0x4c, 0x0, 0x5f, 0x53, 0x49,
+		0x5a, 0x45, 0x27, 0x2c, 0x20, 0x0, 0x27, 0x4d, 0x41, 0x54, 0x43, 0x48, 0x5f, 0x42, 0x88, 0x49, 0x54, 0x53,
+		0x1c, 0xe, 0x4d, 0x41, 0x58, 0x20, 0xd, 0x84, 0x49, 0x4e, 0x1c, 0xd, 0x52, 0x41, 0x4e, 0x47, 0x8, 0x37,
+		0x10, 0x4e, 0x42, 0x42, 0x59, 0x4, 0x8, 0x4f, 0x46, 0x46, 0x48, 0x53, 0x45, 0x54, 0x0, 0x32, 0x53, 0x4b,
+		0x4, 0xf, 0x5f, 0x0, 0x5f, 0x62, 0x75, 0x69, 0x6c, 0x74, 0x69, 0x6e, 0x88, 0x73, 0x5f, 0x5f, 0xc, 0x10,
+		0x64, 0x6f, 0x63, 0x14, 0xb, 0x10, 0x66, 0x69, 0x6c, 0x65, 0x14, 0xc, 0x6e, 0x61, 0x6d, 0x81, 0x18, 0xc,
+		0x70, 0x61, 0x63, 0x6b, 0x61, 0x67, 0x10, 0xf, 0x0, 0x63, 0x6f, 0x6d, 0x70, 0x72, 0x65, 0x73, 0x73, 0x1,
+		0x4, 0xc, 0x64, 0x65, 0x63, 0x6f, 0x64, 0x65, 0x5f, 0x0, 0x73, 0x69, 0x7a, 0x65, 0x27, 0x5d
+	};
+	uint8_t		prefix[16], *put;
+	size_t		i;
+	Arena		arena;
+	LZJBStream	stream;
+
+	/* All at once. */
+	memset(&arena, 0, sizeof arena);
+	lzjbstream_init_alloc(&stream, arena_alloc, &arena);
+	lzjbstream_decompress(&stream, prefixed, sizeof prefixed);
+	if(lzjbstream_is_finished(&stream) && arena.calls == 1 && arena.requested == strlen(text) && memcmp(arena.buf, text, strlen(text)) == 0)
+		test_passed();
+	else
+		test_failed("Failed full-file allocator streaming decompression");
+
+	/* A single byte at a time, so the size prefix is split. */
+	memset(&arena, 0, sizeof arena);
+	lzjbstream_init_alloc(&stream, arena_alloc, &arena);
+	for(i = 0; i < sizeof prefixed; ++i)
+	{
+		if(!lzjbstream_decompress(&stream, prefixed + i, 1))
+			break;
+	}
+	if(lzjbstream_is_finished(&stream) && arena.calls == 1 && memcmp(arena.buf, text, strlen(text)) == 0)
+		test_passed();
+	else
+		test_failed("Failed 1-byte allocator streaming decompression");
+
+	/* A size the allocator refuses must fail, and not look finished. */
+	memset(&arena, 0, sizeof arena);
+	put = lzjbstream_size_encode(prefix, sizeof prefix, 1000);
+	lzjbstream_init_alloc(&stream, arena_alloc, &arena);
+	if(!lzjbstream_decompress(&stream, prefix, put - prefix) && !lzjbstream_is_finished(&stream) && !lzjbstream_decompress(&stream, prefix, 1))
+		test_passed();
+	else
+		test_failed("Failed allocator streaming with refused allocation");
+
+	/* A size of zero finishes without allocating. */
+	memset(&arena, 0, sizeof arena);
+	put = lzjbstream_size_encode(prefix, sizeof prefix, 0);
+	lzjbstream_init_alloc(&stream, arena_alloc, &arena);
+	if(!lzjbstream_decompress(&stream, prefix, put - prefix) && lzjbstream_is_finished(&stream) && arena.calls == 0)
+		test_passed();
+	else
+		test_failed("Failed allocator streaming of zero-size data");
+
+	/* An over-long size prefix is rejected. */
+	memset(prefix, 0x7f, sizeof prefix);
+	lzjbstream_init_alloc(&stream, arena_alloc, &arena);
+	if(!lzjbstream_decompress(&stream, prefix, sizeof prefix) && !lzjbstream_is_finished(&stream))
+		test_passed();
+	else
+		test_failed("Failed to reject over-long size prefix");
+
+	/* The largest size_t is accepted, but one bit more in the final byte is rejected, not truncated. */
+	memset(&arena, 0, sizeof arena);
+	put = lzjbstream_size_encode(prefix, sizeof prefix, ~(size_t) 0);
+	lzjbstream_init_alloc(&stream, arena_alloc, &arena);
+	lzjbstream_decompress(&stream, prefix, put - prefix);
+	if(arena.calls == 1 && arena.requested == ~(size_t) 0)
+		test_passed();
+	else
+		test_failed("Failed to accept size prefix for the largest size_t");
+
+	memset(&arena, 0, sizeof arena);
+	put[-1] = 0xff;
+	lzjbstream_init_alloc(&stream, arena_alloc, &arena);
+	if(!lzjbstream_decompress(&stream, prefix, put - prefix) && !lzjbstream_is_finished(&stream) && arena.calls == 0)
+		test_passed();
+	else
+		test_failed("Failed to reject size prefix overflowing size_t");
+}
+
 int main(int argc, char *argv[])
 {
 	size_t	i;
@@ -226,11 +482,20 @@ int main(int argc, char *argv[])
 
 	printf("Testing lzjb-stream's decompression API ...\n");
 	test_decompress();
+	test_decompress_alloc();
+
+#if defined LZJBSTREAM_WITH_COMPRESS
+	printf("Testing lzjb-stream's compression API ...\n");
+	test_compress();
+#endif
 
 	printf("%zu/%zu tests passed\n", test_state.pass_count, test_state.count);
 
 	printf("Testing performance ...\n");
 	test_performance("performance-data.lzjb");
+#if defined LZJBSTREAM_WITH_COMPRESS
+	test_compress_performance();
+#endif
 
 	printf("By the way, the stream itself is %zu bytes\n", sizeof (LZJBStream));
 